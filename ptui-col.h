@@ -0,0 +1,145 @@
+/*
+ * PTUI stands for "Portable Terminal UI". It is an ANSI C library that
+ * provides simple terminal-handling routines that can operate on Linux,
+ * Windows and DOS.
+ *
+ * This file contains the extended colors (see ptui_extattr()) conversion
+ * helpers that are common to all backends. It is meant to be included by
+ * backend modules only, not to be compiled on its own.
+ *
+ * Copyright (C) 2013-2020 Mateusz Viste
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ptui_col_h_sentinel
+#define ptui_col_h_sentinel
+
+/* returns the 24-bit RGB value of an extended color (see ptui_extattr()) */
+static unsigned long extcol2rgb(unsigned long col) {
+  /* xterm's default values for its 16 first colors */
+  static const unsigned long ansirgb[16] = {
+    0x000000lu, 0x800000lu, 0x008000lu, 0x808000lu, 0x000080lu, 0x800080lu, 0x008080lu, 0xC0C0C0lu,
+    0x808080lu, 0xFF0000lu, 0x00FF00lu, 0xFFFF00lu, 0x0000FFlu, 0xFF00FFlu, 0x00FFFFlu, 0xFFFFFFlu};
+  static const unsigned char cubelevels[6] = {0, 95, 135, 175, 215, 255};
+  unsigned int i;
+  if (col & 0x1000000lu) return(col & 0xFFFFFFlu);
+  i = (unsigned int)(col & 0xFF);
+  if (i < 16) return(ansirgb[i]);
+  if (i < 232) { /* 6x6x6 color cube */
+    i -= 16;
+    return(((unsigned long)cubelevels[i / 36] << 16) | ((unsigned long)cubelevels[(i / 6) % 6] << 8) | cubelevels[i % 6]);
+  }
+  /* grayscale ramp */
+  return((8 + (i - 232) * 10) * 0x010101lu);
+}
+
+
+/* cache of 24-bit color conversions: 4-way set-associative, sets being
+ * picked by a multiplicative hash of the color so neighbour shades of a
+ * gradient spread over all sets. a miss replaces the oldest entry of its set.
+ * keys always have bit 24 set, hence zeroed keys never match. */
+#define COLCACHE_SETS 128
+#define COLCACHE_WAYS 4
+struct colcache {
+  unsigned long key[COLCACHE_SETS][COLCACHE_WAYS];
+  unsigned char val[COLCACHE_SETS][COLCACHE_WAYS];
+};
+
+
+static unsigned int colcache_set(unsigned long col) {
+  /* fold high bits down first, so colors that differ only in their red or
+   * green byte still differ in the low bits, then apply Knuth's multiplicative
+   * hash and keep the top 7 bits of the 32-bit product */
+  col &= 0xFFFFFFlu;
+  col ^= col >> 11;
+  return((unsigned int)(((col * 2654435761lu) & 0xFFFFFFFFlu) >> 25));
+}
+
+
+/* returns the cached value of a 24-bit color, or -1 if not cached */
+static int colcache_get(const struct colcache *c, unsigned long col) {
+  unsigned int set = colcache_set(col), i;
+  for (i = 0; i < COLCACHE_WAYS; i++) {
+    if (c->key[set][i] == col) return(c->val[set][i]);
+  }
+  return(-1);
+}
+
+
+static void colcache_put(struct colcache *c, unsigned long col, unsigned char val) {
+  unsigned int set = colcache_set(col), i;
+  for (i = COLCACHE_WAYS - 1; i > 0; i--) {
+    c->key[set][i] = c->key[set][i - 1];
+    c->val[set][i] = c->val[set][i - 1];
+  }
+  c->key[set][0] = col;
+  c->val[set][0] = val;
+}
+
+
+/* returns the DOS color (0..15) that is closest to an extended color.
+ * palette indexes are translated through a 256-entry table, filled lazily
+ * (each index costs a color-distance search once). 24-bit colors go through
+ * a colcache, so the search is repeated only for colors that have been
+ * evicted (more than 4 colors of the working set falling into one set). */
+static unsigned char extcol2dos(unsigned long col) {
+  /* xterm indexes of the 16 ANSI colors, translated to DOS order */
+  static const unsigned char ansi2dos[16] = {0, 4, 2, 6, 1, 5, 3, 7, 8, 12, 10, 14, 9, 13, 11, 15};
+  /* RGB values of the 16 DOS colors (as displayed by VGA) */
+  static const unsigned long dosrgb[16] = {
+    0x000000lu, 0x0000AAlu, 0x00AA00lu, 0x00AAAAlu, 0xAA0000lu, 0xAA00AAlu, 0xAA5500lu, 0xAAAAAAlu,
+    0x555555lu, 0x5555FFlu, 0x55FF55lu, 0x55FFFFlu, 0xFF5555lu, 0xFF55FFlu, 0xFFFF55lu, 0xFFFFFFlu};
+  static unsigned char idxtable[256]; /* DOS color + 1, 0 if not known yet */
+  static struct colcache cache;
+  unsigned long rgb, dist, bestdist = 0xFFFFFFFFlu;
+  long dr, dg, db;
+  int i, best = 0;
+
+  if ((col & 0x1000000lu) == 0) {
+    col &= 0xFF;
+    if (col < 16) return(ansi2dos[col]);
+    if (idxtable[col] != 0) return(idxtable[col] - 1);
+  } else {
+    col &= 0x1FFFFFFlu;
+    i = colcache_get(&cache, col);
+    if (i >= 0) return(i);
+  }
+
+  rgb = extcol2rgb(col);
+  for (i = 0; i < 16; i++) {
+    dr = (long)((rgb >> 16) & 0xFF) - (long)((dosrgb[i] >> 16) & 0xFF);
+    dg = (long)((rgb >> 8) & 0xFF) - (long)((dosrgb[i] >> 8) & 0xFF);
+    db = (long)(rgb & 0xFF) - (long)(dosrgb[i] & 0xFF);
+    dist = (unsigned long)(dr * dr + dg * dg + db * db);
+    if (dist < bestdist) {
+      bestdist = dist;
+      best = i;
+    }
+  }
+
+  if (col & 0x1000000lu) {
+    colcache_put(&cache, col, best);
+  } else {
+    idxtable[col] = best + 1;
+  }
+  return(best);
+}
+
+#endif
@@ -28,6 +28,14 @@
 #include <pc.h>    /* ScreenRows() */
 
 #include "ptui.h"  /* include self for control */
+#include "ptui-col.h"
+
+
+/* CP437 line-drawing glyphs, indexed by PTUI_BOX_* style: horizontal,
+ * vertical, upper-left, upper-right, lower-left and lower-right */
+static const unsigned char boxglyphs[2][6] = {
+  {0xC4, 0xB3, 0xDA, 0xBF, 0xC0, 0xD9},   /* single */
+  {0xCD, 0xBA, 0xC9, 0xBB, 0xC8, 0xBC}};  /* double */
 
 
 int ptui_hascolor(void) {
@@ -46,6 +54,11 @@ void ptui_close(void) {
 }
 
 
+int ptui_extattr(unsigned long fg, unsigned long bg) {
+  return((extcol2dos(bg) << 4) | extcol2dos(fg));
+}
+
+
 int ptui_getrowcount(void) {
  return(ScreenRows());
 }
@@ -79,6 +92,32 @@ void ptui_putchar_rep(int c, int attr, int x, int y, int r) {
   while (r--) ScreenPutChar(c, attr, x++, y);
 }
 
+void ptui_hline(int style, int attr, int x, int y, int len) {
+  if (len < 1) return;
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  ptui_putchar_rep(boxglyphs[style][0], attr, x, y, len);
+}
+
+void ptui_vline(int style, int attr, int x, int y, int len) {
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  while (len-- > 0) ScreenPutChar(boxglyphs[style][1], attr, x, y++);
+}
+
+void ptui_box(int style, int attr, int x, int y, int width, int height) {
+  const unsigned char *g;
+  if ((width < 2) || (height < 2)) return;
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  g = boxglyphs[style];
+  ScreenPutChar(g[2], attr, x, y);
+  ptui_putchar_rep(g[0], attr, x + 1, y, width - 2);
+  ScreenPutChar(g[3], attr, x + width - 1, y);
+  ptui_vline(style, attr, x, y + 1, height - 2);
+  ptui_vline(style, attr, x + width - 1, y + 1, height - 2);
+  ScreenPutChar(g[4], attr, x, y + height - 1);
+  ptui_putchar_rep(g[0], attr, x + 1, y + height - 1, width - 2);
+  ScreenPutChar(g[5], attr, x + width - 1, y + height - 1);
+}
+
 int ptui_getkey(void) {
   return(getkey());
 }
@@ -102,3 +141,29 @@ void ptui_cursor_hide(void) {
 void ptui_refresh(void) {
   /* nothing here, we draw directly to video memory already */
 }
+
+
+int ptui_framepacing(int maxfps) {
+  /* no pacing here, we draw directly to video memory already */
+  return(-1);
+}
+
+
+int ptui_framepending(void) {
+  return(-1);
+}
+
+
+int ptui_mirror_attach(int fd) {
+  /* no mirroring on DOS, there is nothing to stream to */
+  return(-1);
+}
+
+
+void ptui_mirror_detach(int fd) {
+}
+
+
+int ptui_mirror_apply(int fd) {
+  return(-1);
+}
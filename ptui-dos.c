@@ -27,6 +27,7 @@
 #include <dos.h>
 
 #include "ptui.h"  /* include self for control */
+#include "ptui-col.h"
 
 static unsigned char far *vmem; /* video memory pointer (beginning of page 0) */
 static int term_width = 0, term_height = 0;
@@ -36,6 +37,12 @@ static int mousedetected, mousehidden;
 static unsigned int lastmouse_x, lastmouse_y;
 static int lastmouse_btn = -1;
 
+/* CP437 line-drawing glyphs, indexed by PTUI_BOX_* style: horizontal,
+ * vertical, upper-left, upper-right, lower-left and lower-right */
+static const unsigned char boxglyphs[2][6] = {
+  {0xC4, 0xB3, 0xDA, 0xBF, 0xC0, 0xD9},   /* single */
+  {0xCD, 0xBA, 0xC9, 0xBB, 0xC8, 0xBC}};  /* double */
+
 
 /* returns 1 if color is supported, 0 otherwise */
 int ptui_hascolor(void) {
@@ -92,6 +99,11 @@ void ptui_close(void) {
   }
 }
 
+
+int ptui_extattr(unsigned long fg, unsigned long bg) {
+  return((extcol2dos(bg) << 4) | extcol2dos(fg));
+}
+
 static void cursor_set(int startscanline, int endscanline) {
   union REGS regs;
   regs.h.ah = 0x01;
@@ -171,6 +183,43 @@ void ptui_putchar_rep(int c, int attr, int x, int y, int r) {
 }
 
 
+void ptui_hline(int style, int attr, int x, int y, int len) {
+  if (len < 1) return;
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  ptui_putchar_rep(boxglyphs[style][0], attr, x, y, len);
+}
+
+
+void ptui_vline(int style, int attr, int x, int y, int len) {
+  unsigned char far *p;
+  unsigned char c;
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  c = boxglyphs[style][1];
+  p = vmem + ((y * term_width + x) << 1);
+  while (len-- > 0) {
+    p[0] = c;
+    p[1] = attr;
+    p += term_width << 1; /* next row */
+  }
+}
+
+
+void ptui_box(int style, int attr, int x, int y, int width, int height) {
+  const unsigned char *g;
+  if ((width < 2) || (height < 2)) return;
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  g = boxglyphs[style];
+  ptui_putchar(g[2], attr, x, y);
+  ptui_putchar_rep(g[0], attr, x + 1, y, width - 2);
+  ptui_putchar(g[3], attr, x + width - 1, y);
+  ptui_vline(style, attr, x, y + 1, height - 2);
+  ptui_vline(style, attr, x + width - 1, y + 1, height - 2);
+  ptui_putchar(g[4], attr, x, y + height - 1);
+  ptui_putchar_rep(g[0], attr, x + 1, y + height - 1, width - 2);
+  ptui_putchar(g[5], attr, x + width - 1, y + height - 1);
+}
+
+
 void ptui_mouseshow(int status) {
   union REGS r;
   if (mousedetected == 0) return;
@@ -257,3 +306,29 @@ void ptui_cursor_hide(void) {
 void ptui_refresh(void) {
   /* nothing here, we draw directly to video memory already */
 }
+
+
+int ptui_framepacing(int maxfps) {
+  /* no pacing here, we draw directly to video memory already */
+  return(-1);
+}
+
+
+int ptui_framepending(void) {
+  return(-1);
+}
+
+
+int ptui_mirror_attach(int fd) {
+  /* no mirroring on DOS, there is nothing to stream to */
+  return(-1);
+}
+
+
+void ptui_mirror_detach(int fd) {
+}
+
+
+int ptui_mirror_apply(int fd) {
+  return(-1);
+}
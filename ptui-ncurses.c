@@ -25,44 +25,526 @@
  */
 
 
+#define _XOPEN_SOURCE 600 /* POSIX signals, sockets... */
 #define _XOPEN_SOURCE_EXTENDED
 
 #include <locale.h>
 #include <ncursesw/curses.h>
+#include <errno.h>
+#include <signal.h>
+#ifndef _WIN32
+#include <fcntl.h>     /* O_NONBLOCK */
+#endif
 #include <stdio.h> /* this one contains the NULL definition */
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>  /* gettimeofday() */
+#ifndef _WIN32
+#include <sys/ioctl.h> /* TIOCOUTQ */
+#include <sys/socket.h> /* send() */
+#include <unistd.h>    /* STDOUT_FILENO, read(), write() */
+#endif
 
 #include "ptui.h"  /* include self for control */
+#include "ptui-col.h"
 
 
 /* mouse-related global variables */
 static int lastclick_btn = -1;
 static unsigned short lastclick_x, lastclick_y;
 
+/* window used to read keys from. this is stdscr, unless frame pacing is
+ * enabled: then it is a pad, because getch() on a regular window performs
+ * an implicit refresh that would bypass pacing */
+static WINDOW *inputwin;
+static int inputdelay = 100; /* max time (ms) that getch() blocks for */
 
-static attr_t getorcreatecolor(int col) {
+/* line-drawing glyphs, indexed by PTUI_BOX_* style: horizontal, vertical,
+ * upper-left, upper-right, lower-left and lower-right. filled by ptui_init()
+ * because WACS glyphs are only known once curses is initialized (these are
+ * either unicode or ACS characters, depending on the terminal) */
+static cchar_t boxglyphs[2][6];
+
+/* unicode codepoints of the above glyphs, as reported to mirror observers */
+static const unsigned long boxunicode[2][6] = {
+  {0x2500, 0x2502, 0x250C, 0x2510, 0x2514, 0x2518},   /* single */
+  {0x2550, 0x2551, 0x2554, 0x2557, 0x255A, 0x255D}};  /* double */
+
+/* frame pacing state (see ptui_framepacing()) */
+static int pacing_enabled = 0;
+static long pacing_interval = 0;   /* min time between two frames (us) */
+static struct timeval pacing_last; /* time when last frame was rendered */
+static int pacing_pending = 0;     /* set if a frame has been held back */
+
+/* last curses color pair allocated so far */
+static int lastpair = 0;
+
+/* extended color attributes (see ptui_extattr()): PTUI attribute 0x100+n
+ * refers to extslots[n]. key is 1 + (fg << 8 | bg), fg and bg being indexes
+ * of the 256-color palette. a key of 0 marks an unused slot */
+#define EXTSLOTS 1024
+static struct extslot {
+  unsigned long key;
+  short pair;
+  unsigned char dosattr; /* closest DOS attribute, for mirror observers */
+} extslots[EXTSLOTS];
+static int extslotsused = 0;
+
+/* screen mirroring state (see ptui_mirror_attach()). mir_cur is a copy of
+ * what has been drawn on screen, in PTUI terms (codepoint + DOS attribute),
+ * while mir_sent is the screen as it was last sent to observers */
+#define MIRROR_MAXOBS 8
+#define MIRROR_HDRLEN 10
+static struct mircell {
+  unsigned long c;
+  unsigned char attr;
+} *mir_cur, *mir_sent;
+static int mir_w, mir_h;
+static unsigned char *mir_buf;        /* encoded message, worst-case sized */
+static struct mirobs {
+  int fd;
+  int oldflags;          /* fd flags to restore when detached */
+  int needfull;          /* observer needs a full screen */
+  unsigned char *pend;   /* part of a message the observer did not take yet */
+  long pendoff, pendlen;
+} mir_obs[MIRROR_MAXOBS];
+static int mir_count = 0;
+
+
+/* translates a PTUI color attribute into curses attributes. the color pair
+ * is returned apart (through *pair) so more than 255 pairs may be used */
+static attr_t getorcreatecolor(int col, short *pair) {
   static attr_t DOSPALETTE[256] = {0};
-  static int lastcolid = 0;
+  static short DOSPAIRS[256] = {0};
+  /* extended attribute, as returned by ptui_extattr() */
+  if ((col >= 0x100) && (col < 0x100 + EXTSLOTS)) {
+    *pair = extslots[col - 0x100].pair;
+    return(A_NORMAL);
+  }
+  col &= 0xff;
   /* if color doesn't exist yet, create it */
-  if (DOSPALETTE[col] == 0) {
+  if (DOSPAIRS[col] == 0) {
     unsigned long DOSCOLORS[16] = { COLOR_BLACK, COLOR_BLUE, COLOR_GREEN, COLOR_CYAN, COLOR_RED, COLOR_MAGENTA, COLOR_YELLOW, COLOR_WHITE, COLOR_BLACK, COLOR_BLUE, COLOR_GREEN, COLOR_CYAN, COLOR_RED,   COLOR_MAGENTA, COLOR_YELLOW, COLOR_WHITE };
+    short fg = DOSCOLORS[col & 0x0f], bg = DOSCOLORS[col >> 4];
     if (col & 0x80) {         /* bright background */
-      init_pair(++lastcolid, DOSCOLORS[col >> 4], DOSCOLORS[col & 0xf]);
-      DOSPALETTE[col] = COLOR_PAIR(lastcolid) | WA_BOLD | WA_REVERSE;
+      fg = DOSCOLORS[col >> 4];
+      bg = DOSCOLORS[col & 0xf];
+      DOSPALETTE[col] = WA_BOLD | WA_REVERSE;
     } else if (col & 0x08) {   /* bright foreground */
-      init_pair(++lastcolid, DOSCOLORS[col & 0x0f], DOSCOLORS[col >> 4]);
-      DOSPALETTE[col] = COLOR_PAIR(lastcolid) | A_BOLD;
+      DOSPALETTE[col] = A_BOLD;
     } else {                  /* no bright nothing */
-      init_pair(++lastcolid, DOSCOLORS[col & 0x0f], DOSCOLORS[col >> 4]);
       /* init_pair(col+1, COLOR_BLUE, COLOR_MAGENTA); */
-      DOSPALETTE[col] = COLOR_PAIR(lastcolid) | A_NORMAL;
+      DOSPALETTE[col] = A_NORMAL;
+    }
+    /* no color pair left: use the default pair, without remembering it so
+     * the pair creation is attempted again next time */
+    if ((lastpair + 1 >= COLOR_PAIRS) || (init_pair(lastpair + 1, fg, bg) == ERR)) {
+      *pair = 0;
+      return(DOSPALETTE[col]);
     }
+    DOSPAIRS[col] = ++lastpair;
   }
 
+  *pair = DOSPAIRS[col];
   return(DOSPALETTE[col]);
 }
 
 
+/* returns the index of the 256-color palette that is the closest to an
+ * extended color. 24-bit colors are matched against the 6x6x6 color cube and
+ * the grayscale ramp, results are kept in a colcache (see ptui-col.h) */
+static int extcol2idx(unsigned long col) {
+  static struct colcache cache;
+  int r, g, b, ri, gi, bi, gray, grayi, idx;
+  long dr, dg, db, cubedist, graydist;
+
+  if ((col & 0x1000000lu) == 0) return((int)(col & 0xFF));
+  col &= 0x1FFFFFFlu;
+  idx = colcache_get(&cache, col);
+  if (idx >= 0) return(idx);
+
+  r = (int)((col >> 16) & 0xFF);
+  g = (int)((col >> 8) & 0xFF);
+  b = (int)(col & 0xFF);
+  /* closest cube levels (0, 95, 135, 175, 215, 255) */
+  ri = (r < 48) ? 0 : (r < 115) ? 1 : (r - 35) / 40;
+  gi = (g < 48) ? 0 : (g < 115) ? 1 : (g - 35) / 40;
+  bi = (b < 48) ? 0 : (b < 115) ? 1 : (b - 35) / 40;
+  dr = r - (ri ? 55 + ri * 40 : 0);
+  dg = g - (gi ? 55 + gi * 40 : 0);
+  db = b - (bi ? 55 + bi * 40 : 0);
+  cubedist = dr * dr + dg * dg + db * db;
+  /* closest gray (8, 18, ..., 238) */
+  gray = (r + g + b) / 3;
+  grayi = (gray < 8) ? 0 : (gray > 238) ? 23 : (gray - 3) / 10;
+  dr = r - (8 + grayi * 10);
+  dg = g - (8 + grayi * 10);
+  db = b - (8 + grayi * 10);
+  graydist = dr * dr + dg * dg + db * db;
+
+  if (graydist < cubedist) {
+    idx = 232 + grayi;
+  } else {
+    idx = 16 + ri * 36 + gi * 6 + bi;
+  }
+  colcache_put(&cache, col, idx);
+  return(idx);
+}
+
+
+/* returns the amount of bytes still waiting in the tty's output queue */
+static int tty_backlog(void) {
+#ifdef TIOCOUTQ
+  int n;
+  if (ioctl(STDOUT_FILENO, TIOCOUTQ, &n) == 0) return(n);
+#endif
+  return(0);
+}
+
+
+/* returns how long (us) the FPS cap still forbids rendering a new frame, 0
+ * if a frame may be rendered right away. a clock that went backwards (or a
+ * frame older than a second) never holds anything back */
+static long pacing_wait(const struct timeval *now) {
+  long elapsed;
+  if ((now->tv_sec < pacing_last.tv_sec) || (now->tv_sec - pacing_last.tv_sec >= 2)) return(0);
+  elapsed = (now->tv_sec - pacing_last.tv_sec) * 1000000L + (now->tv_usec - pacing_last.tv_usec);
+  if ((elapsed < 0) || (elapsed >= pacing_interval)) return(0);
+  return(pacing_interval - elapsed);
+}
+
+
+/* renders the screen, unless the FPS cap or the tty backlog asks to hold the
+ * frame back - in such case the frame is only marked as pending so it gets
+ * rendered (merged with whatever has been drawn meanwhile) by a later call */
+static void pacing_flush(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  /* too early for a new frame? */
+  if (pacing_wait(&now) > 0) {
+    pacing_pending = 1;
+    return;
+  }
+  /* is the terminal still busy swallowing the previous frame? */
+  if (tty_backlog() > 0) {
+    pacing_pending = 1;
+    return;
+  }
+  refresh();
+  pacing_last = now;
+  pacing_pending = 0;
+}
+
+
+/* (re)allocates mirror buffers to fit the current screen. cells that fit on
+ * both the old and the new screen are kept (as curses does on resize), the
+ * others are blank. observers will need a full screen afterwards. returns 0
+ * on success */
+static int mirror_alloc(void) {
+  struct mircell *cur, *sent;
+  unsigned char *buf;
+  long i, cells;
+  int x, y, w, h;
+
+  w = getmaxx(stdscr);
+  h = getmaxy(stdscr);
+  cells = (long)w * h;
+  cur = malloc(cells * sizeof(struct mircell));
+  sent = malloc(cells * sizeof(struct mircell));
+  /* worst case: each row is a single span header + one run per cell */
+  buf = malloc(MIRROR_HDRLEN + h * (6 + 5 * (long)w));
+  if ((cur == NULL) || (sent == NULL) || (buf == NULL)) {
+    free(cur);
+    free(sent);
+    free(buf);
+    free(mir_cur);
+    free(mir_sent);
+    free(mir_buf);
+    mir_cur = mir_sent = NULL;
+    mir_buf = NULL;
+    mir_w = mir_h = 0;
+    return(-1);
+  }
+  for (i = 0; i < cells; i++) {
+    cur[i].c = ' ';
+    cur[i].attr = 0x07;
+  }
+  for (y = 0; (y < h) && (y < mir_h); y++) {
+    for (x = 0; (x < w) && (x < mir_w); x++) cur[(long)y * w + x] = mir_cur[(long)y * mir_w + x];
+  }
+  memcpy(sent, cur, cells * sizeof(struct mircell));
+  free(mir_cur);
+  free(mir_sent);
+  free(mir_buf);
+  mir_cur = cur;
+  mir_sent = sent;
+  mir_buf = buf;
+  mir_w = w;
+  mir_h = h;
+  for (i = 0; i < mir_count; i++) mir_obs[i].needfull = 1;
+  return(0);
+}
+
+
+/* follows terminal resizes, whether observers are attached or not, so the
+ * mirror screen copy always matches the curses screen */
+static void mirror_checksize(void) {
+  if ((getmaxx(stdscr) != mir_w) || (getmaxy(stdscr) != mir_h)) mirror_alloc();
+}
+
+
+/* records len cells in the mirror screen copy, starting at x,y and going
+ * either right or down */
+static void mirror_store(unsigned long c, int attr, int x, int y, long len, int vertical) {
+  long i, step, cells;
+  mirror_checksize();
+  cells = (long)mir_w * mir_h;
+  step = vertical ? mir_w : 1;
+  if ((mir_cur == NULL) || (x < 0) || (y < 0) || (x >= mir_w) || (y >= mir_h)) return;
+  /* extended attributes are reported as their closest DOS attribute */
+  if ((attr >= 0x100) && (attr < 0x100 + EXTSLOTS)) {
+    attr = extslots[attr - 0x100].dosattr;
+  }
+  for (i = (long)y * mir_w + x; (len-- > 0) && (i < cells); i += step) {
+    mir_cur[i].c = c;
+    mir_cur[i].attr = attr;
+  }
+}
+
+
+static unsigned char *mirror_put16(unsigned char *p, unsigned int v) {
+  *p++ = (v >> 8) & 0xff;
+  *p++ = v & 0xff;
+  return(p);
+}
+
+
+/* serializes into mir_buf the cells of mir_cur that differ from mir_sent (or
+ * all of them if full is set) and returns the length of the message. a
+ * message is made of a 10-bytes header followed by spans, all integers being
+ * big-endian:
+ *   header: 'P' 'M' width(16) height(16) payload_length(32)
+ *   span:   y(16) x(16) runs_count(16) followed by runs_count runs
+ *   run:    length(8) codepoint(24) attribute(8)
+ * small gaps of unchanged cells are kept within spans, since a span header
+ * costs more than a few extra runs */
+static long mirror_encode(int full) {
+  unsigned char *p = mir_buf + MIRROR_HDRLEN, *nruns;
+  const struct mircell *row, *sent;
+  long payload;
+  int x, y, end, i, j, n;
+
+  for (y = 0; y < mir_h; y++) {
+    row = mir_cur + (long)y * mir_w;
+    sent = mir_sent + (long)y * mir_w;
+    x = 0;
+    while (x < mir_w) {
+      if ((!full) && (row[x].c == sent[x].c) && (row[x].attr == sent[x].attr)) {
+        x++;
+        continue;
+      }
+      /* found a changed cell - look for where the span ends */
+      end = mir_w;
+      if (!full) {
+        for (end = x + 1, i = end; (i < mir_w) && (i - end < 4); i++) {
+          if ((row[i].c != sent[i].c) || (row[i].attr != sent[i].attr)) end = i + 1;
+        }
+      }
+      /* span header, and its runs */
+      p = mirror_put16(p, y);
+      p = mirror_put16(p, x);
+      nruns = p;
+      p += 2;
+      for (n = 0, i = x; i < end; i = j, n++) {
+        for (j = i + 1; (j < end) && (j - i < 255) && (row[j].c == row[i].c) && (row[j].attr == row[i].attr); j++);
+        *p++ = j - i;
+        *p++ = (row[i].c >> 16) & 0xff;
+        *p++ = (row[i].c >> 8) & 0xff;
+        *p++ = row[i].c & 0xff;
+        *p++ = row[i].attr;
+      }
+      mirror_put16(nruns, n);
+      x = end;
+    }
+  }
+
+  payload = (p - mir_buf) - MIRROR_HDRLEN;
+  mir_buf[0] = 'P';
+  mir_buf[1] = 'M';
+  mirror_put16(mir_buf + 2, mir_w);
+  mirror_put16(mir_buf + 4, mir_h);
+  mirror_put16(mir_buf + 6, (payload >> 16) & 0xffff);
+  mirror_put16(mir_buf + 8, payload & 0xffff);
+  return(p - mir_buf);
+}
+
+
+#ifndef _WIN32
+/* write() that never raises SIGPIPE, for observers that are not sockets (no
+ * MSG_NOSIGNAL there): SIGPIPE is blocked during the call and discarded if
+ * the write triggered it (a SIGPIPE that was pending already is left alone) */
+static long write_nosigpipe(int fd, const unsigned char *buf, long len) {
+  sigset_t pipeset, oldset, pending;
+  int waspending, sig, err;
+  long r;
+  sigemptyset(&pipeset);
+  sigaddset(&pipeset, SIGPIPE);
+  sigpending(&pending);
+  waspending = sigismember(&pending, SIGPIPE);
+  sigprocmask(SIG_BLOCK, &pipeset, &oldset);
+  r = write(fd, buf, len);
+  err = errno;
+  if ((r < 0) && (err == EPIPE) && (!waspending)) {
+    sigpending(&pending);
+    if (sigismember(&pending, SIGPIPE)) sigwait(&pipeset, &sig);
+  }
+  sigprocmask(SIG_SETMASK, &oldset, NULL);
+  errno = err;
+  return(r);
+}
+#endif
+
+
+/* writes to an observer as much of buf as it takes without blocking.
+ * returns the amount of bytes written, or -1 if the observer is broken */
+static long mirror_write(int fd, const unsigned char *buf, long len) {
+#ifndef _WIN32
+  long sent = 0, r;
+  while (sent < len) {
+    r = send(fd, buf + sent, len - sent, MSG_NOSIGNAL);
+    if ((r < 0) && (errno == ENOTSOCK)) r = write_nosigpipe(fd, buf + sent, len - sent);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+      return(-1);
+    }
+    sent += r;
+  }
+  return(sent);
+#else
+  return(-1);
+#endif
+}
+
+
+/* sends a message to an observer, keeping whatever it did not take yet in
+ * its pending buffer. returns 0 on success, -1 if the observer is broken */
+static int mirror_send(struct mirobs *o, const unsigned char *buf, long len) {
+  long r = mirror_write(o->fd, buf, len);
+  if (r < 0) return(-1);
+  if (r == len) return(0);
+  o->pend = malloc(len - r);
+  if (o->pend == NULL) return(-1);
+  memcpy(o->pend, buf + r, len - r);
+  o->pendlen = len - r;
+  o->pendoff = 0;
+  return(0);
+}
+
+
+/* forgets about an observer: frees its pending buffer and restores the fd's
+ * original flags (the fd itself is left open) */
+static void mirror_release(struct mirobs *o) {
+  free(o->pend);
+  o->pend = NULL;
+  o->pendlen = 0;
+#ifndef _WIN32
+  fcntl(o->fd, F_SETFL, o->oldflags);
+#endif
+}
+
+
+/* sends to observers whatever changed on screen since the last call. an
+ * observer never blocks the application: if it did not take the whole
+ * previous message yet, it is sent the rest of it (as much as it takes) and
+ * skips the current frame, to be resynced with a full screen once it caught
+ * up. so at most one message is ever queued per observer. */
+static void mirror_flush(void) {
+  int i, j;
+  int done[MIRROR_MAXOBS];
+  int broken[MIRROR_MAXOBS];
+  long len, r;
+  struct mirobs *o;
+
+  mirror_checksize();
+  if (mir_cur == NULL) return;
+
+  /* push whatever is still pending from previous frames */
+  for (i = 0; i < mir_count; i++) {
+    o = &mir_obs[i];
+    done[i] = 0;
+    broken[i] = 0;
+    if (o->pendlen == 0) continue;
+    r = mirror_write(o->fd, o->pend + o->pendoff, o->pendlen);
+    if (r < 0) {
+      broken[i] = 1;
+      continue;
+    }
+    o->pendoff += r;
+    o->pendlen -= r;
+    if (o->pendlen == 0) {
+      free(o->pend);
+      o->pend = NULL;
+      continue;
+    }
+    /* still busy: skip this frame, resync with a full screen later */
+    o->needfull = 1;
+    done[i] = 1;
+  }
+
+  /* new (or lagging) observers get a full screen */
+  for (i = 0; i < mir_count; i++) {
+    if (broken[i] || done[i] || (mir_obs[i].needfull == 0)) continue;
+    break;
+  }
+  if (i < mir_count) {
+    len = mirror_encode(1);
+    for (; i < mir_count; i++) {
+      if (broken[i] || done[i] || (mir_obs[i].needfull == 0)) continue;
+      if (mirror_send(&mir_obs[i], mir_buf, len) != 0) broken[i] = 1;
+      mir_obs[i].needfull = 0;
+      done[i] = 1;
+    }
+  }
+
+  /* everyone else gets a diff, if anything changed at all */
+  len = mirror_encode(0);
+  if (len > MIRROR_HDRLEN) {
+    for (i = 0; i < mir_count; i++) {
+      if (broken[i] || done[i]) continue;
+      if (mirror_send(&mir_obs[i], mir_buf, len) != 0) broken[i] = 1;
+    }
+  }
+  memcpy(mir_sent, mir_cur, (long)mir_w * mir_h * sizeof(struct mircell));
+
+  /* forget about broken observers */
+  for (i = 0, j = 0; i < mir_count; i++) {
+    if (broken[i]) {
+      mirror_release(&mir_obs[i]);
+      continue;
+    }
+    mir_obs[j++] = mir_obs[i];
+  }
+  mir_count = j;
+}
+
+
+#ifndef _WIN32
+/* reads exactly len bytes from fd, returns 0 on success */
+static int readall(int fd, unsigned char *buf, long len) {
+  long r;
+  while (len > 0) {
+    r = read(fd, buf, len);
+    if ((r < 0) && (errno == EINTR)) continue;
+    if (r <= 0) return(-1);
+    buf += r;
+    len -= r;
+  }
+  return(0);
+}
+#endif
+
+
 /* returns 0 on monochrome terminals, 1 on color terminals */
 int ptui_hascolor(void) {
   if (has_colors() == TRUE) return(1);
@@ -78,19 +560,79 @@ int ptui_init(int flags) {
   raw();
   noecho();
   keypad(stdscr, TRUE); /* capture arrow keys */
-  timeout(100); /* getch blocks for 50ms max */
+  inputwin = stdscr;
+  inputdelay = 100;
+  timeout(inputdelay); /* getch blocks for 100ms max */
   set_escdelay(50); /* ESC should wait for 50ms max */
   nonl(); /* allow ncurses to detect KEY_ENTER */
+  /* precompute line-drawing glyphs */
+  boxglyphs[PTUI_BOX_SINGLE][0] = *WACS_HLINE;
+  boxglyphs[PTUI_BOX_SINGLE][1] = *WACS_VLINE;
+  boxglyphs[PTUI_BOX_SINGLE][2] = *WACS_ULCORNER;
+  boxglyphs[PTUI_BOX_SINGLE][3] = *WACS_URCORNER;
+  boxglyphs[PTUI_BOX_SINGLE][4] = *WACS_LLCORNER;
+  boxglyphs[PTUI_BOX_SINGLE][5] = *WACS_LRCORNER;
+  boxglyphs[PTUI_BOX_DOUBLE][0] = *WACS_D_HLINE;
+  boxglyphs[PTUI_BOX_DOUBLE][1] = *WACS_D_VLINE;
+  boxglyphs[PTUI_BOX_DOUBLE][2] = *WACS_D_ULCORNER;
+  boxglyphs[PTUI_BOX_DOUBLE][3] = *WACS_D_URCORNER;
+  boxglyphs[PTUI_BOX_DOUBLE][4] = *WACS_D_LLCORNER;
+  boxglyphs[PTUI_BOX_DOUBLE][5] = *WACS_D_LRCORNER;
   /* enable MOUSE? */
   if (flags & PTUI_ENABLE_MOUSE) {
     mousemask(BUTTON1_RELEASED, NULL);
   }
+  /* keep track of the screen's content for mirror observers (not fatal if
+   * it fails, mirroring is simply not available then) */
+  mirror_alloc();
   return(0);
 }
 
 
+int ptui_extattr(unsigned long fg, unsigned long bg) {
+  unsigned long key;
+  unsigned int slot;
+  int fgi, bgi;
+
+  /* terminals with less than 256 colors get a plain DOS attribute */
+  if (COLORS < 256) return((extcol2dos(bg) << 4) | extcol2dos(fg));
+
+  fgi = extcol2idx(fg);
+  bgi = extcol2idx(bg);
+  key = 1 + (((unsigned long)fgi << 8) | bgi);
+  /* look for an existing pair (open addressing, linear probing) */
+  slot = (unsigned int)((fgi * 977lu + bgi) % EXTSLOTS);
+  while (extslots[slot].key != 0) {
+    if (extslots[slot].key == key) return(0x100 + slot);
+    slot = (slot + 1) % EXTSLOTS;
+  }
+  /* allocate a new pair, unless the table is getting full or the terminal
+   * has no more pairs to offer: then fall back to a plain DOS attribute.
+   * 256 pairs are kept in reserve for DOS attributes (getorcreatecolor()),
+   * since both kinds of attributes draw from the same pairs */
+  if ((extslotsused >= EXTSLOTS * 3 / 4) || (extslotsused >= COLOR_PAIRS - 1 - 256) || (lastpair + 1 > 0x7FFF)) {
+    return((extcol2dos(bg) << 4) | extcol2dos(fg));
+  }
+  if (init_pair(lastpair + 1, fgi, bgi) == ERR) return((extcol2dos(bg) << 4) | extcol2dos(fg));
+  lastpair++;
+  extslots[slot].key = key;
+  extslots[slot].pair = lastpair;
+  extslots[slot].dosattr = (extcol2dos(bg) << 4) | extcol2dos(fg);
+  extslotsused++;
+  return(0x100 + slot);
+}
+
+
 void ptui_close(void) {
+  ptui_framepacing(-1); /* releases the input pad, if any */
   endwin();
+  while (mir_count > 0) mirror_release(&mir_obs[--mir_count]);
+  free(mir_cur);
+  free(mir_sent);
+  free(mir_buf);
+  mir_cur = mir_sent = NULL;
+  mir_buf = NULL;
+  mir_w = mir_h = 0;
 }
 
 
@@ -117,6 +659,7 @@ void ptui_cls(void) {
   }
   attroff(0);
   /* bkgd(COLOR_PAIR(colattr)); */
+  mirror_store(' ', 0x07, 0, 0, (long)maxcols * maxrows, 0);
   move(0,0);
   ptui_refresh();
 }
@@ -136,15 +679,19 @@ void ptui_locate(int x, int y) {
 void ptui_putchar(int wchar, int attr, int x, int y) {
   int oldx, oldy;
   cchar_t t;
-
-  memset(&t, 0, sizeof(t));
+  wchar_t wch[2];
+  attr_t a;
+  short pair;
 
   /* remember cursor position to restore it afterwards */
   getyx(stdscr, oldy, oldx);
 
-  t.attr = getorcreatecolor(attr);
-  t.chars[0] = wchar;
+  a = getorcreatecolor(attr, &pair);
+  wch[0] = wchar;
+  wch[1] = 0;
+  setcchar(&t, wch, a, pair, NULL);
   mvadd_wch(y, x, &t);
+  mirror_store(wchar, attr, x, y, 1, 0);
 
   /* restore cursor to its initial location */
   move(oldy, oldx);
@@ -154,14 +701,18 @@ void ptui_putchar(int wchar, int attr, int x, int y) {
 void ptui_putchar_rep(int wchar, int attr, int x, int y, int r) {
   int oldx, oldy;
   cchar_t t;
-
-  memset(&t, 0, sizeof(t));
+  wchar_t wch[2];
+  attr_t a;
+  short pair;
 
   /* remember cursor position to restore it afterwards */
   getyx(stdscr, oldy, oldx);
 
-  t.attr = getorcreatecolor(attr);
-  t.chars[0] = wchar;
+  a = getorcreatecolor(attr, &pair);
+  wch[0] = wchar;
+  wch[1] = 0;
+  setcchar(&t, wch, a, pair, NULL);
+  mirror_store(wchar, attr, x, y, r, 0);
   while (r--) mvadd_wch(y, x++, &t);
 
   /* restore cursor to its initial location */
@@ -169,6 +720,63 @@ void ptui_putchar_rep(int wchar, int attr, int x, int y, int r) {
 }
 
 
+/* draws len times the line-drawing glyph boxglyphs[style][glyph] as a single
+ * horizontal (or vertical) run */
+static void drawglyphs(int style, int glyph, int attr, int x, int y, int len, int vertical) {
+  int oldx, oldy;
+  cchar_t t;
+  wchar_t wch[CCHARW_MAX + 1];
+  attr_t gattr, a;
+  short gpair, pair;
+
+  if (len < 1) return;
+
+  /* remember cursor position to restore it afterwards */
+  getyx(stdscr, oldy, oldx);
+
+  /* keep the glyph's own attributes (A_ALTCHARSET for ACS glyphs) */
+  getcchar(&boxglyphs[style][glyph], wch, &gattr, &gpair, NULL);
+  a = getorcreatecolor(attr, &pair);
+  setcchar(&t, wch, gattr | a, pair, NULL);
+  if (vertical) {
+    mvvline_set(y, x, &t, len);
+    mirror_store(boxunicode[style][glyph], attr, x, y, len, 1);
+  } else {
+    mvhline_set(y, x, &t, len);
+    mirror_store(boxunicode[style][glyph], attr, x, y, len, 0);
+  }
+
+  /* restore cursor to its initial location */
+  move(oldy, oldx);
+}
+
+
+void ptui_hline(int style, int attr, int x, int y, int len) {
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  drawglyphs(style, 0, attr, x, y, len, 0);
+}
+
+
+void ptui_vline(int style, int attr, int x, int y, int len) {
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  drawglyphs(style, 1, attr, x, y, len, 1);
+}
+
+
+void ptui_box(int style, int attr, int x, int y, int width, int height) {
+  if ((width < 2) || (height < 2)) return;
+  if (style != PTUI_BOX_DOUBLE) style = PTUI_BOX_SINGLE;
+  drawglyphs(style, 2, attr, x, y, 1, 0);
+  drawglyphs(style, 0, attr, x + 1, y, width - 2, 0);
+  drawglyphs(style, 3, attr, x + width - 1, y, 1, 0);
+  drawglyphs(style, 1, attr, x, y + 1, height - 2, 1);
+  drawglyphs(style, 1, attr, x + width - 1, y + 1, height - 2, 1);
+  drawglyphs(style, 4, attr, x, y + height - 1, 1, 0);
+  drawglyphs(style, 0, attr, x + 1, y + height - 1, width - 2, 0);
+  drawglyphs(style, 5, attr, x + width - 1, y + height - 1, 1, 0);
+}
+
+
 int ptui_getmouse(unsigned int *x, unsigned *y) {
   int r = lastclick_btn;
   if (lastclick_btn < 0) return(-1);
@@ -183,7 +791,7 @@ int ptui_getkey(void) {
   int res;
 
   for (;;) {
-    res = getch();
+    res = wgetch(inputwin);
     if (res == KEY_MOUSE) {
       MEVENT event;
       if (getmouse(&event) == OK) {
@@ -197,11 +805,13 @@ int ptui_getkey(void) {
       continue; /* ignore invalid mouse events */
     }
     if (res != ERR) break;          /* ERR means "no input available yet" */
+    /* idle - good time to render a frame that pacing has held back */
+    if (pacing_pending) pacing_flush();
   }
 
   /* either ESC or ALT+some key */
   if (res == 27) {
-    res = getch();
+    res = wgetch(inputwin);
     if (res == ERR) return(27);
     /* else this is an ALT+something combination */
     switch (res) {
@@ -242,10 +852,13 @@ int ptui_getkey(void) {
 
 int ptui_kbhit(void) {
   int tmp;
-  timeout(0);
-  tmp = getch();
-  timeout(100);
-  if (tmp == ERR) return(0);
+  wtimeout(inputwin, 0);
+  tmp = wgetch(inputwin);
+  wtimeout(inputwin, inputdelay);
+  if (tmp == ERR) {
+    if (pacing_pending) pacing_flush();
+    return(0);
+  }
   ungetch(tmp);
   return(1);
 }
@@ -266,5 +879,147 @@ void ptui_cursor_hide(void) {
 
 
 void ptui_refresh(void) {
+  if (mir_count > 0) {
+    mirror_flush();
+  } else {
+    mirror_checksize();
+  }
+  if (pacing_enabled) {
+    pacing_flush();
+    return;
+  }
   refresh();
 }
+
+
+int ptui_framepacing(int maxfps) {
+  /* disable pacing: flush any held back frame and go back to stdscr input */
+  if (maxfps < 0) {
+    if (pacing_enabled == 0) return(0);
+    pacing_enabled = 0;
+    if (pacing_pending) refresh();
+    pacing_pending = 0;
+    delwin(inputwin);
+    inputwin = stdscr;
+    inputdelay = 100;
+    return(0);
+  }
+  /* enable pacing - input is read from a pad, since getch() does not
+   * perform implicit refreshes on pads */
+  if (pacing_enabled == 0) {
+    WINDOW *pad = newpad(1, 1);
+    if (pad == NULL) return(-1);
+    keypad(pad, TRUE);
+    inputwin = pad;
+    pacing_enabled = 1;
+    gettimeofday(&pacing_last, NULL);
+  }
+  pacing_interval = 0;
+  inputdelay = 100;
+  if (maxfps > 0) {
+    pacing_interval = 1000000L / maxfps;
+    /* getch() must not block longer than a frame, otherwise held back
+     * frames would wait for a key press */
+    if (pacing_interval / 1000 < inputdelay) inputdelay = pacing_interval / 1000;
+    if (inputdelay < 10) inputdelay = 10;
+  }
+  wtimeout(inputwin, inputdelay);
+  return(0);
+}
+
+
+int ptui_framepending(void) {
+  struct timeval now;
+  long wait;
+  if (pacing_pending == 0) return(-1);
+  gettimeofday(&now, NULL);
+  wait = pacing_wait(&now);
+  if (wait > 0) return((int)((wait + 999) / 1000));
+  /* FPS cap is fine, but the terminal is still busy - check again soon */
+  if (tty_backlog() > 0) return(10);
+  return(0);
+}
+
+
+int ptui_mirror_attach(int fd) {
+#ifndef _WIN32
+  struct mirobs *o;
+  int i, flags;
+  if ((mir_cur == NULL) || (mir_count >= MIRROR_MAXOBS)) return(-1);
+  for (i = 0; i < mir_count; i++) if (mir_obs[i].fd == fd) return(0);
+  /* an observer must never be able to block the application */
+  flags = fcntl(fd, F_GETFL);
+  if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) return(-1);
+  o = &mir_obs[mir_count++];
+  o->fd = fd;
+  o->oldflags = flags;
+  o->needfull = 1;
+  o->pend = NULL;
+  o->pendoff = 0;
+  o->pendlen = 0;
+  return(0);
+#else
+  return(-1);
+#endif
+}
+
+
+void ptui_mirror_detach(int fd) {
+  int i;
+  for (i = 0; i < mir_count; i++) {
+    if (mir_obs[i].fd != fd) continue;
+    mirror_release(&mir_obs[i]);
+    mir_obs[i] = mir_obs[--mir_count];
+    return;
+  }
+}
+
+
+int ptui_mirror_apply(int fd) {
+#ifndef _WIN32
+  static unsigned char *buf;
+  static long bufsz;
+  unsigned char hdr[MIRROR_HDRLEN];
+  const unsigned char *p, *bufend;
+  unsigned long c;
+  long payload;
+  int cols, rows, x, y, nruns, len, attr;
+
+  if (readall(fd, hdr, MIRROR_HDRLEN) != 0) return(-1);
+  if ((hdr[0] != 'P') || (hdr[1] != 'M')) return(-1);
+  payload = ((long)hdr[6] << 24) | ((long)hdr[7] << 16) | ((long)hdr[8] << 8) | hdr[9];
+  if ((payload < 0) || (payload > 0x1000000l)) return(-1);
+  if (payload > bufsz) {
+    unsigned char *newbuf = realloc(buf, payload);
+    if (newbuf == NULL) return(-1);
+    buf = newbuf;
+    bufsz = payload;
+  }
+  if (readall(fd, buf, payload) != 0) return(-1);
+
+  /* apply spans, clipping whatever does not fit on the local screen */
+  getmaxyx(stdscr, rows, cols);
+  p = buf;
+  bufend = buf + payload;
+  while (p < bufend) {
+    if (bufend - p < 6) return(-1);
+    y = (p[0] << 8) | p[1];
+    x = (p[2] << 8) | p[3];
+    nruns = (p[4] << 8) | p[5];
+    p += 6;
+    if (bufend - p < 5l * nruns) return(-1);
+    for (; nruns > 0; nruns--, p += 5) {
+      len = p[0];
+      c = ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+      attr = p[4];
+      if ((y < rows) && (x < cols)) {
+        ptui_putchar_rep(c, attr, x, y, (x + len > cols) ? cols - x : len);
+      }
+      x += len;
+    }
+  }
+  return(0);
+#else
+  return(-1);
+#endif
+}
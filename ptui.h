@@ -38,6 +38,18 @@ int ptui_hascolor(void);
 
 void ptui_close(void);
 
+/* returns a color attribute made of extended fg and bg colors. the result
+ * may be passed as attr to any PTUI drawing routine, in place of a classic
+ * single-byte DOS attribute. an extended color is either an index of the
+ * 256-color xterm palette (0..255) or a 24-bit color built with PTUI_RGB().
+ * colors are converted to the closest ones the terminal is able to display
+ * (possibly down to a plain DOS attribute). conversions are cached: palette
+ * indexes through a precomputed table, 24-bit colors through a cache of 512
+ * recently used colors, so the nearest-color search runs once per distinct
+ * color as long as the working set fits in the cache.
+ * this must be called only AFTER ptui_init() */
+int ptui_extattr(unsigned long fg, unsigned long bg);
+
 /* returns the number of rows of current text mode */
 int ptui_getrowcount(void);
 
@@ -61,6 +73,19 @@ void ptui_putchar(int c, int attr, int x, int y);
  * about line overflow - count chars should never go out of screen!) */
 void ptui_putchar_rep(int c, int attr, int x, int y, int count);
 
+/* draws a horizontal line of len cells starting at x,y, using the
+ * line-drawing glyphs of the platform. style is PTUI_BOX_SINGLE or
+ * PTUI_BOX_DOUBLE. the line must not go out of screen. */
+void ptui_hline(int style, int attr, int x, int y, int len);
+
+/* same as ptui_hline(), but draws a vertical line going down from x,y */
+void ptui_vline(int style, int attr, int x, int y, int len);
+
+/* draws the frame of a width x height box whose upper-left corner is at x,y
+ * (inside of the box is left untouched). style is PTUI_BOX_SINGLE or
+ * PTUI_BOX_DOUBLE. nothing is drawn if width or height is less than 2. */
+void ptui_box(int style, int attr, int x, int y, int width, int height);
+
 /* waits for a key to be pressed and returns it. ALT+keys have 0x100 added to
  * them. this may also report a "PTUI_MOUSE" key in case of a mouse click,
  * in such case call ptui_getmouse() to fetch the details about last click) */
@@ -88,10 +113,55 @@ void ptui_cursor_hide(void);
 /* tell the UI library to render the screen (ignored on platforms that perform immediate rendering) */
 void ptui_refresh(void);
 
+/* enables adaptive frame pacing: ptui_refresh() then renders at most maxfps
+ * frames per second and holds frames back while the terminal still has
+ * output queued (typically a slow remote link). Held-back frames are merged,
+ * only the latest screen state gets rendered once the link drains - this
+ * happens on a later ptui_refresh(), or while waiting in ptui_getkey() or
+ * ptui_kbhit(). applications that wait for events on their own (poll/select)
+ * should use ptui_framepending() to know when to call ptui_refresh() again.
+ * maxfps == 0 keeps the backlog check without any FPS cap, maxfps < 0
+ * disables pacing (default). This must be called only AFTER ptui_init().
+ * returns 0 on success, non-zero if the platform does not support pacing
+ * (ie. platforms that perform immediate rendering) */
+int ptui_framepacing(int maxfps);
+
+/* returns -1 if frame pacing holds no frame back. otherwise, returns the
+ * time (in ms, possibly 0) after which ptui_refresh() should be called to
+ * get the held back frame rendered - suitable as a poll() timeout */
+int ptui_framepending(void);
+
+/* attaches a read-only observer to the screen: from now on, every
+ * ptui_refresh() sends to fd (typically a socket) the cells that changed
+ * since the previous refresh, as a run-length encoded diff message. the
+ * first message sent to an observer contains the full screen. fd is switched
+ * to non-blocking mode, so a slow observer never stalls the application: the
+ * part of a message it did not take yet is sent on later refreshes, frames
+ * are skipped meanwhile and the observer is resynced with a full screen once
+ * it caught up. a broken observer is detached (fd is not closed).
+ * returns 0 on success, non-zero on error (too many observers, or platform
+ * without mirroring support). this must be called only AFTER ptui_init() */
+int ptui_mirror_attach(int fd);
+
+/* detaches an observer previously attached to the screen. fd is not closed,
+ * its original blocking mode is restored */
+void ptui_mirror_detach(int fd);
+
+/* reads one mirror message from fd and draws it on the local screen (parts
+ * that do not fit are clipped), a call to ptui_refresh() is then needed to
+ * render it. returns 0 on success, non-zero on error or end of stream. */
+int ptui_mirror_apply(int fd);
+
 
 /* some public definitions used by PTUI */
 
 #define PTUI_ENABLE_MOUSE 1 /* may be passed to ptui_init() */
 #define PTUI_MOUSE 0x200   /* returned by ptui_getkey() to advertise a mouse event */
 
+#define PTUI_BOX_SINGLE 0  /* single-line style for ptui_box() & co */
+#define PTUI_BOX_DOUBLE 1  /* double-line style for ptui_box() & co */
+
+/* builds a 24-bit extended color for ptui_extattr() */
+#define PTUI_RGB(r, g, b) (0x1000000lu | ((unsigned long)(r) << 16) | ((unsigned long)(g) << 8) | (unsigned long)(b))
+
 #endif
@@ -0,0 +1,85 @@
+/*
+ * ptuiview - a read-only viewer for PTUI screen mirroring. It connects to a
+ * unix socket where a PTUI application streams its screen through
+ * ptui_mirror_attach(), and displays whatever it receives. Press ESC to quit.
+ *
+ *    cc ptuiview.c ptui-ncurses.c -lncursesw -o ptuiview
+ *    ./ptuiview /path/to/socket
+ *
+ * Copyright (C) 2013-2020 Mateusz Viste
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ptui.h"
+
+
+int main(int argc, char **argv) {
+  struct sockaddr_un addr;
+  struct pollfd pfd;
+  int fd;
+
+  if ((argc != 2) || (strlen(argv[1]) >= sizeof(addr.sun_path))) {
+    fprintf(stderr, "usage: ptuiview /path/to/socket\n");
+    return(1);
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return(1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, argv[1]);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    perror("connect");
+    close(fd);
+    return(1);
+  }
+
+  if (ptui_init(0) != 0) {
+    fprintf(stderr, "failed to init the terminal\n");
+    close(fd);
+    return(1);
+  }
+  ptui_cursor_hide();
+  ptui_cls();
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  for (;;) {
+    if ((ptui_kbhit() != 0) && (ptui_getkey() == 27)) break;
+    if (poll(&pfd, 1, 50) <= 0) continue;
+    if (ptui_mirror_apply(fd) != 0) break; /* end of stream */
+    ptui_refresh();
+  }
+
+  ptui_cursor_show();
+  ptui_close();
+  close(fd);
+  return(0);
+}